@@ -0,0 +1,79 @@
+/*
+ * This program compares cost of frame statistics computed by v4l2_pp with a separate full frame pass,
+ * as done after getImage() by the application. It doesn't need a camera.
+ */
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include "../v4l2_pp/v4l2_camera.h"
+
+using namespace std;
+
+const int width = 1920;
+const int height = 1080;
+const int iterations = 100;
+
+/**
+ * Application style pass: histogram, mean and gradient computed pixel by pixel through FrameView::luma()
+ */
+template<uint32_t Format>
+void fullPass(V4L2::FrameView<Format> const& frame, V4L2::FrameStatistics *stats)
+{
+    uint64_t sum = 0, gradient = 0;
+    for(int i = 0; i < 256; i++)
+        stats->histogram[i] = 0;
+    for(int y = 0; y < frame.height(); y++){
+        // Luma of each pixel is computed once, previous one is kept for gradient
+        int previous = frame.luma(0, y);
+        for(int x = 0; x < frame.width(); x++){
+            int luma = frame.luma(x, y);
+            stats->histogram[luma]++;
+            sum += luma;
+            gradient += abs(luma - previous);
+            previous = luma;
+        }
+    }
+    stats->mean_luma = (double)sum / (width * height);
+    stats->sharpness = (double)gradient / ((width - 1) * height);
+}
+
+/**
+ * @return microseconds per megapixel
+ */
+template<typename F>
+double measure(F function)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; i++)
+        function();
+    std::chrono::nanoseconds time = std::chrono::steady_clock::now() - start;
+    return (double)time.count() / 1000 / iterations / (width * height / 1e6);
+}
+
+template<uint32_t Format>
+void benchmark(const char *name)
+{
+    V4L2::FrameView<Format> frame(NULL, width, height);
+    std::vector<uint8_t> data(frame.size());
+    for(size_t i = 0; i < data.size(); i++)
+        data[i] = rand();
+    frame = V4L2::FrameView<Format>(data.data(), width, height);
+
+    V4L2::FrameStatistics stats;
+    cout<<name<<" full pass:       "<<measure([&](){ fullPass(frame, &stats); })<<" us/MP"<<endl;
+    for(int subsample = 1; subsample <= 4; subsample *= 2){
+        cout<<name<<" statistics /"<<subsample<<":  "<<measure([&](){
+                V4L2::computeStatistics(data.data(), Format, width, height, 0, V4L2::STATISTICS_ALL, subsample, &stats);
+            })<<" us/MP"<<endl;
+    }
+}
+
+int main()
+{
+    benchmark<V4L2_PIX_FMT_GREY>("GREY ");
+    benchmark<V4L2_PIX_FMT_YUYV>("YUYV ");
+    benchmark<V4L2_PIX_FMT_RGB24>("RGB24");
+    benchmark<V4L2_PIX_FMT_NV12>("NV12 ");
+}
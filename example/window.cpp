@@ -1,4 +1,6 @@
 #include "window.h"
+#include <cstdio>
+#include <cstring>
 
 Window::Window(){
     set_border_width(10);
@@ -16,8 +18,13 @@ Window::Window(){
     camera_select->append("/dev/video0");
     camera_select->append("/dev/video1");
 
+    overlay.add(*interactive_image);
+    stats_label.set_halign(Gtk::ALIGN_START);
+    stats_label.set_valign(Gtk::ALIGN_START);
+    overlay.add_overlay(stats_label);
+
     grid.insert_column(2);
-    grid.attach(*interactive_image, 0, 0, 4, 10);
+    grid.attach(overlay, 0, 0, 4, 10);
 
 
     grid.attach(*stop_button, 0, 10, 1, 1);
@@ -29,6 +36,9 @@ Window::Window(){
     grab_button->signal_clicked().connect( sigc::mem_fun(*this, &Window::takeOnce));
     cont_button->signal_clicked().connect( sigc::mem_fun(*this, &Window::continueTaking));
     camera_select->signal_changed().connect(sigc::mem_fun(*this,&Window::changeCamera) );
+    dispatcher.connect(sigc::mem_fun(*this, &Window::showNewImage));
+    last_stats = std::chrono::steady_clock::now();
+    Glib::signal_timeout().connect(sigc::mem_fun(*this, &Window::updateStats), 1000);
 
     show_all();
 }
@@ -43,9 +53,17 @@ void Window::addCallbacks(callback c1, callback c2, callback c3, path_callback c
 
 void Window::setImageSize(int x, int y)
 {
+    std::lock_guard<std::mutex> write_lock(write_mutex);
+    std::lock_guard<std::mutex> pending_lock(pending_mutex);
     this->image.init = true;
     this->image.x = x;
     this->image.y = y;
+
+    // Displayed pixbuf is kept by image until the next one is shown
+    write_pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, false, 8, x, y);
+    pending_pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, false, 8, x, y);
+    front_pixbuf = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, false, 8, x, y);
+    pending = false;
 }
 
 void Window::changeCamera(){
@@ -81,7 +99,53 @@ void Window::getNewImage(unsigned char* image2){
     if(image2 == NULL)
         return;
 
-    pixbuf1 = Gdk::Pixbuf::create_from_data((guint8*)image2, Gdk::COLORSPACE_RGB, false, 8, image.x, image.y, image.x*3); 
-    interactive_image->set(pixbuf1);
-    interactive_image->show();
+    captured_frames++;
+    {
+        // Camera buffer is given back to driver after callback, so it is copied into pixbuf owned by window
+        std::lock_guard<std::mutex> write_lock(write_mutex);
+        V4L2::FrameView<V4L2_PIX_FMT_RGB24> frame(image2, image.x, image.y);
+        guint8 *pixels = write_pixbuf->get_pixels();
+        int rowstride = write_pixbuf->get_rowstride();
+        for(int y = 0; y < frame.height(); y++)
+            memcpy(pixels + y * rowstride, frame.row(y), frame.elements() * sizeof(V4L2::RGB24Pixel));
+
+        std::lock_guard<std::mutex> pending_lock(pending_mutex);
+        std::swap(write_pixbuf, pending_pixbuf);
+        if(pending){
+            // Main loop didn't show previous image yet, it is replaced by the newer one
+            dropped_frames++;
+            return;
+        }
+        pending = true;
+    }
+    dispatcher.emit();
+}
+
+void Window::showNewImage(){
+    // Image is changed under the lock, so capture thread can't get the pixbuf still shown by image
+    std::lock_guard<std::mutex> pending_lock(pending_mutex);
+    if(!pending)
+        return;
+    std::swap(pending_pixbuf, front_pixbuf);
+    pending = false;
+    interactive_image->set(front_pixbuf);
+    displayed_frames++;
+}
+
+bool Window::updateStats(){
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - last_stats).count();
+    unsigned int captured = captured_frames;
+    unsigned int displayed = displayed_frames;
+
+    char text[128];
+    snprintf(text, sizeof(text), "capture %.1f fps\ndisplay %.1f fps\ndropped %u",
+            (captured - last_captured) / seconds, (displayed - last_displayed) / seconds,
+            (unsigned int)dropped_frames);
+    stats_label.set_markup(Glib::ustring("<span background=\"black\" foreground=\"white\">") + text + "</span>");
+
+    last_captured = captured;
+    last_displayed = displayed;
+    last_stats = now;
+    return true;
 }
@@ -7,6 +7,10 @@
 
 #include <memory>
 #include <iostream>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "../v4l2_pp/v4l2_frame.h"
 class Window: public Gtk::Window 
 {
     public:
@@ -17,6 +21,9 @@ class Window: public Gtk::Window
         typedef void (*path_callback)(const char *path);
         void addCallbacks(callback c1, callback c2, callback c3, path_callback c4);
         /*! Recive an Image
+         *
+         * It may be called from capture thread. Image is copied into free pixbuf of the pool
+         * and only the newest one is shown by GTK main loop. Older not shown images are dropped.
          *
          * \param image the image to show
          */
@@ -25,7 +32,23 @@ class Window: public Gtk::Window
         callback continous, stop, once;
         path_callback change_camera;
         Gtk::Image *interactive_image;
-        Glib::RefPtr<Gdk::Pixbuf> pixbuf1, pixbuf2;
+        Gtk::Overlay overlay;
+        Gtk::Label stats_label;
+
+        // Pool of three pixbufs: written by capture thread, waiting for display and displayed
+        Glib::RefPtr<Gdk::Pixbuf> write_pixbuf, pending_pixbuf, front_pixbuf;
+        bool pending = false;
+        std::mutex write_mutex;
+        std::mutex pending_mutex;
+        Glib::Dispatcher dispatcher;
+
+        // Counters shown on overlay
+        std::atomic<unsigned int> captured_frames{0};
+        std::atomic<unsigned int> displayed_frames{0};
+        std::atomic<unsigned int> dropped_frames{0};
+        unsigned int last_captured = 0;
+        unsigned int last_displayed = 0;
+        std::chrono::steady_clock::time_point last_stats;
         Gtk::Button *stop_button;
 
         Gtk::Button *cont_button;
@@ -37,6 +60,8 @@ class Window: public Gtk::Window
         void takeOnce ();
         void continueTaking ();
         void changeCamera();
+        void showNewImage();
+        bool updateStats();
 
         struct image_parameters{
             bool init = false;
@@ -1,4 +1,10 @@
 #include "v4l2_camera.h"
+#include <cstring>
+#include <cstdio>
+#include <future>
+#include <cmath>
+#include <poll.h>
+#include <unistd.h>
 
 using namespace V4L2;
 
@@ -39,11 +45,17 @@ int Camera::setSize(int width, int height)
     if(ret != 0)
         return CAMERA_ERROR;
 
-    if (fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_RGB24)
+    if (fmt.fmt.pix.pixelformat != (unsigned int)pix_fmt)
         return CAMERA_WRONG_PIXELFORMAT;
 
     camera_size.first = fmt.fmt.pix.width;
     camera_size.second = fmt.fmt.pix.height;
+    bytes_per_line = fmt.fmt.pix.bytesperline;
+
+    // Drivers (i.e. UVC) reset frame interval to default of the new format
+    if(frame_rate != 0)
+        applyFrameRate();
+
     if(camera_size.first != width || camera_size.second != height)
         return CAMERA_DIFFERENT_SIZE;
 
@@ -72,13 +84,473 @@ int Camera::open(){
         return CAMERA_CANNOT_OPEN;
     }
     state = STOPPED;
+    trace_camera = Trace::registerCamera(dev_name);
 
     return setSize(std::get<0>(camera_size), std::get<1>(camera_size));
 }
 
+int Camera::queryControls()
+{
+    if(state == CLOSED)
+        return CAMERA_BAD_STATE;
+
+    std::vector<Control> found;
+    struct v4l2_query_ext_ctrl query;
+    uint32_t id = V4L2_CTRL_FLAG_NEXT_CTRL | V4L2_CTRL_FLAG_NEXT_COMPOUND;
+    while(true){
+        memset(&query, 0, sizeof(query));
+        query.id = id;
+        try {
+            xioctl(fd, VIDIOC_QUERY_EXT_CTRL, &query);
+        } catch(std::string const&) {
+            // EINVAL ends enumeration
+            break;
+        }
+        id = query.id | V4L2_CTRL_FLAG_NEXT_CTRL | V4L2_CTRL_FLAG_NEXT_COMPOUND;
+
+        if(query.flags & (V4L2_CTRL_FLAG_DISABLED | V4L2_CTRL_FLAG_HAS_PAYLOAD))
+            continue;
+        if(query.type == V4L2_CTRL_TYPE_CTRL_CLASS)
+            continue;
+
+        Control control;
+        control.id = query.id;
+        control.type = query.type;
+        control.name = query.name;
+        control.minimum = query.minimum;
+        control.maximum = query.maximum;
+        control.step = query.step;
+        control.default_value = query.default_value;
+        control.flags = query.flags;
+        control.value = query.default_value;
+        found.push_back(control);
+    }
+
+    readControlValues(found, false);
+
+    std::lock_guard<std::mutex> lock(controls_mutex);
+    controls.swap(found);
+    return CAMERA_SUCCESS;
+}
+
+void Camera::readControlValues(std::vector<Control> &list, bool volatile_only)
+{
+    // Read all values at once. When driver refuses any of them, read them one by one
+    std::vector<struct v4l2_ext_control> values;
+    for(Control const& control : list){
+        if(control.flags & V4L2_CTRL_FLAG_WRITE_ONLY)
+            continue;
+        if(volatile_only && !(control.flags & V4L2_CTRL_FLAG_VOLATILE))
+            continue;
+        struct v4l2_ext_control value;
+        memset(&value, 0, sizeof(value));
+        value.id = control.id;
+        values.push_back(value);
+    }
+    if(values.empty())
+        return;
+
+    struct v4l2_ext_controls ext;
+    memset(&ext, 0, sizeof(ext));
+    ext.which = V4L2_CTRL_WHICH_CUR_VAL;
+    ext.count = values.size();
+    ext.controls = values.data();
+    bool read = false;
+    try {
+        read = xioctl(fd, VIDIOC_G_EXT_CTRLS, &ext) == 0;
+    } catch(std::string const&) {}
+
+    for(struct v4l2_ext_control &value : values){
+        if(!read){
+            ext.count = 1;
+            ext.controls = &value;
+            try {
+                xioctl(fd, VIDIOC_G_EXT_CTRLS, &ext);
+            } catch(std::string const&) {
+                continue;
+            }
+        }
+        for(Control &control : list){
+            if(control.id == value.id)
+                control.value = control.type == V4L2_CTRL_TYPE_INTEGER64 ? value.value64 : value.value;
+        }
+    }
+}
+
+void Camera::refreshControls()
+{
+    struct v4l2_query_ext_ctrl query;
+    for(Control &control : controls){
+        memset(&query, 0, sizeof(query));
+        query.id = control.id;
+        try {
+            xioctl(fd, VIDIOC_QUERY_EXT_CTRL, &query);
+        } catch(std::string const&) {
+            continue;
+        }
+        control.flags = query.flags;
+        control.minimum = query.minimum;
+        control.maximum = query.maximum;
+    }
+    readControlValues(controls, false);
+}
+
+int Camera::getControls(std::vector<Control> *controls)
+{
+    std::lock_guard<std::mutex> lock(controls_mutex);
+    if(this->controls.empty())
+        return CAMERA_BAD_STATE;
+    readControlValues(this->controls, true);
+    *controls = this->controls;
+    return CAMERA_SUCCESS;
+}
+
+int Camera::getControl(uint32_t id, int64_t *value)
+{
+    std::lock_guard<std::mutex> lock(controls_mutex);
+    for(Control &control : controls){
+        if(control.id != id)
+            continue;
+
+        // Volatile values (i.e. exposure set by auto exposure) are changed by device, cache would be stale
+        if(control.flags & V4L2_CTRL_FLAG_VOLATILE){
+            std::vector<Control> one(1, control);
+            readControlValues(one, true);
+            control.value = one[0].value;
+        }
+        *value = control.value;
+        return CAMERA_SUCCESS;
+    }
+    return CAMERA_ERROR;
+}
+
+int Camera::setControl(uint32_t id, int64_t value, bool next_frame)
+{
+    return setControls(ControlValues(1, std::make_pair(id, value)), next_frame);
+}
+
+int Camera::setControls(ControlValues const& values, bool next_frame)
+{
+    if(state == CLOSED)
+        return CAMERA_BAD_STATE;
+
+    std::vector<struct v4l2_ext_control> ext_values;
+    std::lock_guard<std::mutex> lock(controls_mutex);
+    for(std::pair<uint32_t, int64_t> const& value : values){
+        struct v4l2_ext_control ext_value;
+        memset(&ext_value, 0, sizeof(ext_value));
+        ext_value.id = value.first;
+        ext_value.value64 = value.second;
+        for(Control const& control : controls){
+            if(control.id == value.first && control.type != V4L2_CTRL_TYPE_INTEGER64)
+                ext_value.value = value.second;
+        }
+
+        if(!next_frame){
+            ext_values.push_back(ext_value);
+            continue;
+        }
+        // Later value of the same control replaces pending one
+        bool replaced = false;
+        for(struct v4l2_ext_control &pending : pending_controls){
+            if(pending.id == ext_value.id){
+                pending = ext_value;
+                replaced = true;
+            }
+        }
+        if(!replaced)
+            pending_controls.push_back(ext_value);
+    }
+
+    if(next_frame){
+        controls_pending = !pending_controls.empty();
+        return CAMERA_SUCCESS;
+    }
+    return applyControls(ext_values);
+}
+
+void Camera::applyPendingControls()
+{
+    // Capture thread may run with real-time priority, so it never waits for controls_mutex held by other thread
+    // across ioctl. When the mutex is busy, values are set after one of the next frames.
+    if(!controls_pending)
+        return;
+    std::unique_lock<std::mutex> lock(controls_mutex, std::try_to_lock);
+    if(!lock.owns_lock())
+        return;
+    // Refused values are dropped, otherwise they would be refused on every frame
+    queued_controls_result = applyControls(pending_controls);
+    pending_controls.clear();
+    controls_pending = false;
+}
+
+int Camera::getQueuedControlsResult()
+{
+    std::lock_guard<std::mutex> lock(controls_mutex);
+    return queued_controls_result;
+}
+
+int Camera::applyControls(std::vector<struct v4l2_ext_control> &values)
+{
+    if(values.empty())
+        return CAMERA_SUCCESS;
+
+    struct v4l2_ext_controls ext;
+    memset(&ext, 0, sizeof(ext));
+    ext.which = V4L2_CTRL_WHICH_CUR_VAL;
+    ext.count = values.size();
+    ext.controls = values.data();
+    try {
+        xioctl(fd, VIDIOC_S_EXT_CTRLS, &ext);
+    } catch(std::string const&) {
+        // error_idx < count means driver may have already set some of the values, cache has to be read again
+        if(ext.error_idx < ext.count){
+            std::vector<Control> changed;
+            for(struct v4l2_ext_control const& value : values){
+                for(Control const& control : controls){
+                    if(control.id == value.id)
+                        changed.push_back(control);
+                }
+            }
+            readControlValues(changed, false);
+            for(Control const& value : changed){
+                for(Control &control : controls){
+                    if(control.id == value.id)
+                        control.value = value.value;
+                }
+            }
+        }
+        return CAMERA_ERROR;
+    }
+
+    // Driver writes back values it really set
+    bool update = false;
+    for(struct v4l2_ext_control const& value : values){
+        for(Control &control : controls){
+            if(control.id != value.id)
+                continue;
+            control.value = control.type == V4L2_CTRL_TYPE_INTEGER64 ? value.value64 : value.value;
+            update |= (control.flags & V4L2_CTRL_FLAG_UPDATE) != 0;
+        }
+    }
+
+    // Changed control affects other controls (i.e. EXPOSURE_AUTO makes exposure inactive)
+    if(update)
+        refreshControls();
+    return CAMERA_SUCCESS;
+}
+
+int Camera::setThreadConfig(ThreadConfig const& config)
+{
+    thread_config = config;
+    return CAMERA_SUCCESS;
+}
+
+int Camera::applyThreadConfig()
+{
+    if(!thread_config.cpus.empty()){
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for(int cpu : thread_config.cpus)
+            CPU_SET(cpu, &cpus);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+            return CAMERA_ERROR;
+    }
+
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = thread_config.priority;
+    if(pthread_setschedparam(pthread_self(), thread_config.policy, &param) != 0)
+        return CAMERA_ERROR;
+
+    return CAMERA_SUCCESS;
+}
+
+int Camera::startCaptureThread(sync_callback callback)
+{
+    if(capture_thread.joinable())
+        return CAMERA_BAD_STATE;
+    mutex.lock();
+    int state_cp = state;
+    mutex.unlock();
+    if(state_cp != STARTED)
+        return CAMERA_BAD_STATE;
+
+    std::promise<int> configured;
+    std::future<int> result = configured.get_future();
+    capture_thread_result = CAMERA_SUCCESS;
+    capture_thread = std::thread([this, callback, &configured](){
+        int ret = applyThreadConfig();
+        configured.set_value(ret);
+        if(ret != CAMERA_SUCCESS)
+            return;
+        // Exception can't leave the thread, it would terminate whole process (i.e. DQBUF fails after unplugging)
+        try {
+            getImagesContinuously(callback);
+        } catch(std::string const& error) {
+            fprintf(stderr, "Capture thread: %s\n", error.c_str());
+            capture_thread_result = CAMERA_ERROR;
+            mutex.lock();
+            state = STARTED;
+            mutex.unlock();
+        }
+    });
+
+    int ret = result.get();
+    if(ret != CAMERA_SUCCESS)
+        capture_thread.join();
+    return ret;
+}
+
+int Camera::joinCaptureThread()
+{
+    if(!capture_thread.joinable())
+        return CAMERA_BAD_STATE;
+    // Thread can't join itself. Callback should return STOP instead
+    if(capture_thread.get_id() == std::this_thread::get_id())
+        return CAMERA_BAD_STATE;
+
+    stop_flag = true;
+    capture_thread.join();
+    stop_flag = false;
+    return capture_thread_result;
+}
+
+bool Camera::waitForFrame()
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    // Timeout lets stop_flag be checked when camera doesn't send frames
+    while(!stop_flag){
+        int r = poll(&pfd, 1, 100);
+        if(r > 0)
+            return true;
+        if(r == -1 && errno != EINTR)
+            return false;
+    }
+    return false;
+}
+
+void Camera::updateJitter()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(jitter_mutex);
+    if(!jitter_started){
+        // First frame, nothing to compare with
+        last_dequeue = now;
+        jitter_started = true;
+        return;
+    }
+
+    double interval = std::chrono::duration<double, std::micro>(now - last_dequeue).count();
+    last_dequeue = now;
+    jitter.frames++;
+    double delta = interval - jitter.mean;
+    jitter.mean += delta / jitter.frames;
+    jitter_m2 += delta * (interval - jitter.mean);
+    jitter.stddev = jitter.frames > 1 ? std::sqrt(jitter_m2 / (jitter.frames - 1)) : 0;
+    if(jitter.frames == 1 || interval < jitter.min)
+        jitter.min = interval;
+    if(interval > jitter.max)
+        jitter.max = interval;
+}
+
+int Camera::getJitter(JitterStatistics *jitter)
+{
+    std::lock_guard<std::mutex> lock(jitter_mutex);
+    *jitter = this->jitter;
+    return CAMERA_SUCCESS;
+}
+
+int Camera::setFrameRate(unsigned int fps)
+{
+    frame_rate = fps;
+    if(state != STOPPED)
+        return CAMERA_BAD_STATE;
+
+    return applyFrameRate();
+}
+
+unsigned int Camera::getFrameRate(unsigned int *driver_fps)
+{
+    if(driver_fps != NULL)
+        *driver_fps = driver_frame_rate;
+    return frame_rate;
+}
+
+int Camera::applyFrameRate()
+{
+    frame_interval = std::chrono::microseconds(0);
+    driver_frame_rate = 0;
+
+    struct v4l2_streamparm parm;
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    try {
+        xioctl(fd, VIDIOC_G_PARM, &parm);
+    } catch(std::string const&) {
+        parm.parm.capture.capability = 0;
+    }
+
+    if(parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME){
+        if(frame_rate != 0){
+            parm.parm.capture.timeperframe.numerator = 1;
+            parm.parm.capture.timeperframe.denominator = frame_rate;
+            try {
+                // Driver writes back interval it really uses
+                xioctl(fd, VIDIOC_S_PARM, &parm);
+            } catch(std::string const&) {}
+        }
+        struct v4l2_fract &tpf = parm.parm.capture.timeperframe;
+        if(tpf.numerator != 0)
+            driver_frame_rate = (tpf.denominator + tpf.numerator / 2) / tpf.numerator;
+    }
+
+    if(frame_rate == 0)
+        return CAMERA_SUCCESS;
+    if(driver_frame_rate != 0 && driver_frame_rate <= frame_rate)
+        return CAMERA_SUCCESS;
+
+    frame_interval = std::chrono::microseconds(1000000 / frame_rate);
+    return CAMERA_DIFFERENT_FRAME_RATE;
+}
+
+bool Camera::skipFrame(struct v4l2_buffer const& buffer)
+{
+    if(frame_interval.count() == 0)
+        return false;
+
+    std::chrono::microseconds timestamp = std::chrono::seconds(buffer.timestamp.tv_sec)
+        + std::chrono::microseconds(buffer.timestamp.tv_usec);
+    // Not every driver fills timestamp
+    if(timestamp.count() == 0)
+        timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch());
+
+    // Source period, measured or given by driver. Half of it is allowed as slack, so jitter or sensor running
+    // slightly fast doesn't move delivery to the next frame
+    std::chrono::microseconds period(0);
+    if(last_frame_timestamp.count() != 0 && timestamp > last_frame_timestamp)
+        period = timestamp - last_frame_timestamp;
+    else if(driver_frame_rate != 0)
+        period = std::chrono::microseconds(1000000 / driver_frame_rate);
+    last_frame_timestamp = timestamp;
+
+    if(timestamp + period / 2 < next_frame_due)
+        return true;
+
+    next_frame_due += frame_interval;
+    if(next_frame_due <= timestamp)
+        next_frame_due = timestamp + frame_interval;
+    return false;
+}
+
 int Camera::unprepare(){
     int ret;
     for (unsigned int i = 0; i < n_buffers; ++i){
+        if(buffers[i].locked)
+            munlock(buffers[i].start, buffers[i].length);
         ret = v4l2_munmap(buffers[i].start, buffers[i].length);
         if(ret == -1)
             return CAMERA_ERROR;
@@ -110,8 +582,27 @@ int Camera::prepare(){
 
         if (MAP_FAILED == buffers[n_buffers].start) {
             perror("mmap");
+            // Release what was mapped, so the next startCapturing() can request buffers again
+            unprepare();
+            req.count = 0;
+            try {
+                xioctl(fd, VIDIOC_REQBUFS, &req);
+            } catch(std::string const&) {}
             return CAMERA_ERROR;
         }
+
+        if (thread_config.lock_memory) {
+            // Default RLIMIT_MEMLOCK is often smaller than the buffers, capturing works without locking too
+            if (mlock(buffers[n_buffers].start, buffers[n_buffers].length) == -1)
+                perror("mlock, buffer stays unlocked");
+            else
+                buffers[n_buffers].locked = true;
+            // Touch every page, so first frames don't pay for page faults
+            volatile unsigned char *page = (volatile unsigned char*)buffers[n_buffers].start;
+            size_t page_size = sysconf(_SC_PAGESIZE);
+            for (size_t offset = 0; offset < buffers[n_buffers].length; offset += page_size)
+                (void)page[offset];
+        }
     }
 
     return CAMERA_SUCCESS;
@@ -137,12 +628,18 @@ int Camera::startCapturing()
     if(ret == -1)
         return CAMERA_ERROR;
     state = STARTED;
-
+    next_frame_due = std::chrono::microseconds(0);
+    last_frame_timestamp = std::chrono::microseconds(0);
+    motion_detector.reset();
 
     return CAMERA_SUCCESS;
 }
 
 Camera::~Camera(){
+    // When destroyed from its own callback, thread can't be joined, but it mustn't stay joinable
+    if(capture_thread.joinable() && capture_thread.get_id() == std::this_thread::get_id())
+        capture_thread.detach();
+    joinCaptureThread();
     stopCapturing();
     close();
 }
@@ -150,21 +647,62 @@ Camera::~Camera(){
 int Camera::getImagesContinuously(sync_callback callback)
 {
     mutex.lock();
-    if(state != STARTED)
+    if(state != STARTED){
+        mutex.unlock();
         return CAMERA_BAD_STATE;
+    }
     state = CONTINOUS;
     mutex.unlock();
+
+    jitter_mutex.lock();
+    jitter = JitterStatistics();
+    jitter_m2 = 0;
+    jitter_started = false;
+    jitter_mutex.unlock();
+
     ContinousControl run = ContinousControl::CONTINUE;
     while (run != ContinousControl::STOP) {
+        {
+            // Driver stalls show as long wait spans
+            Trace::Span span("wait", trace_camera);
+            if(!waitForFrame())
+                break;
+        }
         buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         buf.memory = V4L2_MEMORY_MMAP;
-        xioctl(fd, VIDIOC_DQBUF, &buf);
+        {
+            // libv4l2 converts format inside DQBUF, so this span covers conversion too
+            Trace::Span span("DQBUF", trace_camera);
+            xioctl(fd, VIDIOC_DQBUF, &buf);
+            span.setFrame(buf.sequence);
+        }
+        updateJitter();
 
         if(stop_flag)
             break;
-        run = callback((unsigned char*)buffers[buf.index].start);
-
-        xioctl(fd, VIDIOC_QBUF, &buf);
+        {
+            // Before skipping, so queued controls don't wait for a delivered frame
+            Trace::Span span("controls", trace_camera, buf.sequence);
+            applyPendingControls();
+        }
+        // libv4l2 has already converted skipped frames, skipping only saves callback
+        if(skipFrame(buf) || !detectChange(buf)){
+            Trace::Span span("QBUF skipped", trace_camera, buf.sequence);
+            xioctl(fd, VIDIOC_QBUF, &buf);
+            continue;
+        }
+        {
+            Trace::Span span("statistics", trace_camera, buf.sequence);
+            updateStatistics(buf);
+        }
+        {
+            Trace::Span span("callback", trace_camera, buf.sequence);
+            run = callback((unsigned char*)buffers[buf.index].start);
+        }
+        {
+            Trace::Span span("QBUF", trace_camera, buf.sequence);
+            xioctl(fd, VIDIOC_QBUF, &buf);
+        }
     }
     mutex.lock();
     state = STARTED;
@@ -182,6 +720,9 @@ int Camera::restartCapturing()
 
 int Camera::stopCapturing()
 {
+    if(capture_thread.joinable() && capture_thread.get_id() != std::this_thread::get_id())
+        joinCaptureThread();
+
     mutex.lock();
     int state_cp = state;
     mutex.unlock();
@@ -219,6 +760,13 @@ int Camera::close()
         return CAMERA_BAD_STATE;
     v4l2_close(fd);
     state = CLOSED;
+
+    // Next device may have different controls
+    std::lock_guard<std::mutex> lock(controls_mutex);
+    controls.clear();
+    pending_controls.clear();
+    controls_pending = false;
+    queued_controls_result = CAMERA_SUCCESS;
     return CAMERA_SUCCESS;
 }
 
@@ -246,13 +794,82 @@ unsigned char *Camera::getImage(){
 
     buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     buf.memory = V4L2_MEMORY_MMAP;
-    xioctl(fd, VIDIOC_DQBUF, &buf);
+    {
+        Trace::Span span("DQBUF", trace_camera);
+        xioctl(fd, VIDIOC_DQBUF, &buf);
+        span.setFrame(buf.sequence);
+    }
+    updateStatistics(buf);
     unsigned char *buffers_ = (unsigned char*)buffers[buf.index].start;
-    xioctl(fd, VIDIOC_QBUF, &buf);
+    {
+        Trace::Span span("QBUF", trace_camera, buf.sequence);
+        xioctl(fd, VIDIOC_QBUF, &buf);
+    }
     state = STARTED;
     return buffers_;
 }
 
+int Camera::setStatistics(unsigned int flags, int subsample)
+{
+    // Capture loop can't start while mutex is locked
+    std::lock_guard<std::mutex> lock(mutex);
+    if(state == CONTINOUS)
+        return CAMERA_BAD_STATE;
+    statistics_flags = flags;
+    statistics_subsample = subsample < 1 ? 1 : subsample;
+    statistics.flags = STATISTICS_NONE;
+    return CAMERA_SUCCESS;
+}
+
+int Camera::getStatistics(FrameStatistics *stats)
+{
+    if(statistics.flags == STATISTICS_NONE)
+        return CAMERA_ERROR;
+    *stats = statistics;
+    return CAMERA_SUCCESS;
+}
+
+void Camera::updateStatistics(struct v4l2_buffer const& buffer)
+{
+    if(statistics_flags == STATISTICS_NONE)
+        return;
+
+    computeStatistics((const uint8_t*)buffers[buffer.index].start, pix_fmt,
+            camera_size.first, camera_size.second, bytes_per_line,
+            statistics_flags, statistics_subsample, &statistics);
+    statistics.sequence = buffer.sequence;
+}
+
+bool Camera::detectChange(struct v4l2_buffer const& buffer)
+{
+    if(!motion_detection)
+        return true;
+
+    Trace::Span span("motion", trace_camera, buffer.sequence);
+    return motion_detector.process((const uint8_t*)buffers[buffer.index].start, pix_fmt,
+            camera_size.first, camera_size.second, bytes_per_line);
+}
+
+int Camera::setMotionDetection(bool enable, int block_threshold, double min_changed)
+{
+    // Capture loop reads detector buffers, so they can't be replaced while it runs
+    std::lock_guard<std::mutex> lock(mutex);
+    if(state == CONTINOUS)
+        return CAMERA_BAD_STATE;
+    motion_detection = enable;
+    motion_detector = MotionDetector(block_threshold, min_changed);
+    return CAMERA_SUCCESS;
+}
+
+const std::vector<unsigned char>* Camera::getChangeMask(int *columns, int *rows)
+{
+    if(!motion_detection)
+        return NULL;
+    *columns = motion_detector.columns();
+    *rows = motion_detector.rows();
+    return &motion_detector.mask();
+}
+
 int Camera::xioctl(int fh, int request, void *arg)
 {
     int r = -1;
@@ -261,7 +878,7 @@ int Camera::xioctl(int fh, int request, void *arg)
     } while (r == -1 && ((errno == EINTR) || (errno == EAGAIN)));
 
     if (r == -1) {
-        throw std::string("Error " + errno);
+        throw std::string("Error ") + strerror(errno);
         return 1;
     }
     return 0;
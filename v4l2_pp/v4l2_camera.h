@@ -27,8 +27,19 @@
 #include <sys/mman.h>
 #include <linux/videodev2.h>
 #include "/usr/include/libv4l2.h"
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
 #include <thread>
 #include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+#include "v4l2_frame.h"
+#include "v4l2_stats.h"
+#include "v4l2_motion.h"
+#include "v4l2_trace.h"
 
 /**
  * The namespace of the wrapper.
@@ -44,7 +55,8 @@ namespace V4L2 {
         CAMERA_CANNOT_OPEN,///<Can't open device. Probably it doesn't exist or it is busy now.
         CAMERA_WRONG_PIXELFORMAT,///<Set pixelformat wasn't accepted.
         CAMERA_ERROR,///<Unknown error.
-        CAMERA_DIFFERENT_SIZE///<Changed size to not the given one. Get current size using getSize().
+        CAMERA_DIFFERENT_SIZE,///<Changed size to not the given one. Get current size using getSize().
+        CAMERA_DIFFERENT_FRAME_RATE///<Driver didn't accept frame rate, frames are skipped by library after they are dequeued and converted. Get driver frame rate using getFrameRate().
     };
 
     /**
@@ -55,6 +67,47 @@ namespace V4L2 {
         STOP///<Stop getting images
     } ContinousControl;
 
+    /**
+     * Description and cached value of camera control (i.e. V4L2_CID_EXPOSURE_ABSOLUTE)
+     */
+    struct Control {
+        uint32_t id;///<Control id
+        uint32_t type;///<Type of control (enum v4l2_ctrl_type)
+        std::string name;///<Name given by driver
+        int64_t minimum;///<Minimal value
+        int64_t maximum;///<Maximal value
+        uint64_t step;///<Step between values
+        int64_t default_value;///<Default value
+        uint32_t flags;///<V4L2_CTRL_FLAG_* flags
+        int64_t value;///<Current value, as last read or set
+    };
+
+    /**
+     * List of control id and value pairs
+     */
+    typedef std::vector<std::pair<uint32_t, int64_t> > ControlValues;
+
+    /**
+     * Configuration of capture thread started by Camera::startCaptureThread()
+     */
+    struct ThreadConfig {
+        std::vector<int> cpus;///<CPUs the thread may run on. Empty means any CPU
+        int policy = SCHED_OTHER;///<Scheduling policy (SCHED_OTHER, SCHED_FIFO or SCHED_RR). Real-time policies need CAP_SYS_NICE
+        int priority = 0;///<Priority for SCHED_FIFO and SCHED_RR (1-99)
+        bool lock_memory = false;///<Lock buffers in memory (mlock) and prefault them when capturing starts. Needs RLIMIT_MEMLOCK, otherwise buffers stay unlocked and a warning is printed
+    };
+
+    /**
+     * Intervals between frames dequeued in getImagesContinuously(), in microseconds
+     */
+    struct JitterStatistics {
+        uint64_t frames = 0;///<Number of measured intervals
+        double mean = 0;///<Mean interval
+        double stddev = 0;///<Standard deviation of interval
+        double min = 0;///<Shortest interval
+        double max = 0;///<Longest interval
+    };
+
     /**
      * This class maganes camera using V4L2 API. Using this class you can easily get Image and manipulate parameters.
      */
@@ -125,6 +178,55 @@ namespace V4L2 {
             int getImagesContinuously(sync_callback callback);
 
 
+            /**
+             * Sets configuration of capture thread. It has to be called before startCaptureThread()
+             * and, to lock memory, before startCapturing().
+             * @param config thread configuration
+             * @return CAMERA_SUCCESS
+             * @see startCaptureThread()
+             */
+            int setThreadConfig(ThreadConfig const& config);
+
+            /**
+             * Starts thread owned by camera, which calls getImagesContinuously() with given callback.
+             * Before capturing, thread sets CPU affinity and scheduling given by setThreadConfig().
+             * \code    {.cpp}
+             * V4L2::ThreadConfig config;
+             * config.cpus = {3};
+             * config.policy = SCHED_FIFO;
+             * config.priority = 50;
+             * config.lock_memory = true;
+             * camera.setThreadConfig(config);
+             * camera.startCapturing();
+             * camera.startCaptureThread([](unsigned char *bytes){
+             *     return V4L2::ContinousControl::CONTINUE;
+             * });
+             * \endcode
+             * @param callback calback or lambda expression to call
+             * @return CAMERA_SUCCESS
+             * @return CAMERA_BAD_STATE when thread is running or startCapturing() wasn't called
+             * @return CAMERA_ERROR when affinity or scheduling can't be set. Thread isn't started then
+             * @see joinCaptureThread()
+             */
+            int startCaptureThread(sync_callback callback);
+
+            /**
+             * Stops capture thread started by startCaptureThread() and waits for it. It is called by stopCapturing() too.
+             * It can't be called from callback, return ContinousControl::STOP there instead.
+             * @return CAMERA_SUCCESS
+             * @return CAMERA_BAD_STATE when thread isn't running or when called from capture thread
+             * @return CAMERA_ERROR when capturing failed (i.e. device was unplugged). Error is printed to stderr
+             */
+            int joinCaptureThread();
+
+            /**
+             * Gets jitter of dequeue loop in getImagesContinuously(), measured since it was started.
+             * It may be called from any thread.
+             * @param jitter pointer for statistics
+             * @return CAMERA_SUCCESS
+             */
+            int getJitter(JitterStatistics *jitter);
+
             /**
              * Opens camera for capturing. Before retriving images, you need to call startCapturing()
              * After opening you can get current image size using getSize
@@ -239,6 +341,156 @@ namespace V4L2 {
              */
             int setSettings(int request, void* structure);
 
+            /**
+             * Enumerates controls of device (VIDIOC_QUERY_EXT_CTRL) and reads their values once.
+             * Later getControl() returns cached values without asking driver, except volatile controls (V4L2_CTRL_FLAG_VOLATILE),
+             * which are read from driver. When control with V4L2_CTRL_FLAG_UPDATE is set, flags and values of all controls are read again.
+             * Compound controls and controls with payload are skipped.
+             * @return CAMERA_SUCCESS
+             * @return CAMERA_BAD_STATE when called before open()
+             * @see getControls()
+             */
+            int queryControls();
+
+            /**
+             * Gets controls found by queryControls() with cached values. Volatile controls are read from driver in one call.
+             * @param controls pointer for controls
+             * @return CAMERA_SUCCESS
+             * @return CAMERA_BAD_STATE when queryControls() wasn't called
+             */
+            int getControls(std::vector<Control> *controls);
+
+            /**
+             * Gets cached value of control. Value of volatile control is read from driver.
+             * @param id control id (i.e. V4L2_CID_GAIN)
+             * @param value pointer for value
+             * @return CAMERA_SUCCESS
+             * @return CAMERA_ERROR when control wasn't found by queryControls()
+             */
+            int getControl(uint32_t id, int64_t *value);
+
+            /**
+             * Sets one control. Works as setControls() with one value.
+             * @see setControls()
+             */
+            int setControl(uint32_t id, int64_t value, bool next_frame = false);
+
+            /**
+             * Sets many controls at once, using single VIDIOC_S_EXT_CTRLS call.
+             * On error some of the values may be already set. Cached values of given controls are read again then.
+             * \code    {.cpp}
+             * camera.setControls({{V4L2_CID_EXPOSURE_ABSOLUTE, 100}, {V4L2_CID_GAIN, 20}}, true);
+             * \endcode
+             * @param values control ids with new values
+             * @param next_frame when true, values are joined with other pending values and set by getImagesContinuously()
+             * in one call after the next frame is dequeued (or a later one, when controls are being accessed by other thread at that moment), even when that frame is skipped. It may be called from any thread.
+             * When driver doesn't accept queued values, they are dropped. Use getQueuedControlsResult() to check it.
+             * @return CAMERA_SUCCESS (for next_frame it only means values were queued)
+             * @return CAMERA_BAD_STATE when called before open()
+             * @return CAMERA_ERROR when driver didn't accept values
+             * @see getQueuedControlsResult()
+             */
+            int setControls(ControlValues const& values, bool next_frame = false);
+
+            /**
+             * Gets result of the last setting of values queued by setControls() with next_frame.
+             * It may be called from any thread.
+             * @return CAMERA_SUCCESS when values were set or nothing was queued yet
+             * @return CAMERA_ERROR when driver didn't accept values. They were dropped
+             */
+            int getQueuedControlsResult();
+
+            /**
+             * Sets frame rate of images delivered by getImagesContinuously().
+             * It asks driver to change frame interval (VIDIOC_S_PARM). Only this saves CPU: frames which aren't captured
+             * aren't dequeued nor converted.
+             * When driver doesn't support it, or it can't go as slow as requested, frames are skipped right after dequeuing,
+             * so callback is called with requested rate. It doesn't save conversion: when libv4l2 emulates pixel format
+             * (i.e. RGB24 from MJPEG or YUYV), it converts every frame inside VIDIOC_DQBUF, skipped ones too.
+             * Frame rate is remembered and applied again by setSize() and open(), so it is kept after format change and reopen().
+             * @param fps requested frames per second. 0 means no skipping, driver frame rate is not changed.
+             * @return CAMERA_SUCCESS when driver accepted given frame rate
+             * @return CAMERA_DIFFERENT_FRAME_RATE when driver runs faster and frames are skipped by library after conversion
+             * @return CAMERA_BAD_STATE when called before open() or while capturing. Frame rate will be applied by next setSize() or open()
+             * @see getFrameRate()
+             */
+            int setFrameRate(unsigned int fps);
+
+            /**
+             * Gets frame rate set by setFrameRate().
+             * @param driver_fps pointer for frame rate of the driver (0 when unknown). May be NULL.
+             * @return frames per second delivered to callback. 0 means every frame is delivered.
+             */
+            unsigned int getFrameRate(unsigned int *driver_fps = NULL);
+
+            /**
+             * Wraps image returned by getImage() or passed to callback into typed view.
+             * Size and bytes per line are taken from current format.
+             * @tparam Format V4L2 pixel format (i.e. V4L2_PIX_FMT_RGB24). It has to be the format camera was created with.
+             * @param bytes image data
+             * @return view of the image
+             * @return invalid view (FrameView::valid() is false) when Format differs from camera format
+             * \code    {.cpp}
+             * camera.getImagesContinuously([](unsigned char *bytes){
+             *     V4L2::FrameView<V4L2_PIX_FMT_YUYV> frame = camera.view<V4L2_PIX_FMT_YUYV>(bytes);
+             *     uint8_t y = frame.luma(10, 20);
+             *     return V4L2::ContinousControl::CONTINUE;
+             * });
+             * \endcode
+             */
+            template<uint32_t Format>
+            FrameView<Format> view(unsigned char *bytes)
+            {
+                if((uint32_t)pix_fmt != Format)
+                    return FrameView<Format>(NULL, 0, 0);
+                return FrameView<Format>(bytes, camera_size.first, camera_size.second, bytes_per_line);
+            }
+
+            /**
+             * Enables statistics computed on every delivered frame, right after it is dequeued.
+             * They are computed on luma of the native format buffer, before callback reads it.
+             * @param flags STATISTICS_* values joined with |. STATISTICS_NONE disables statistics.
+             * @param subsample only every subsample-th row is used. Higher values are cheaper.
+             * @return CAMERA_SUCCESS
+             * @return CAMERA_BAD_STATE while getImagesContinuously() or capture thread runs
+             * @see getStatistics()
+             */
+            int setStatistics(unsigned int flags, int subsample = 1);
+
+            /**
+             * Gets statistics of the last image returned by getImage() or passed to callback.
+             * Call it from callback to get statistics of the image being processed.
+             * @param stats pointer for statistics
+             * @return CAMERA_SUCCESS
+             * @return CAMERA_ERROR when statistics are disabled or weren't computed for current format
+             * @see setStatistics()
+             */
+            int getStatistics(FrameStatistics *stats);
+
+            /**
+             * Enables change detection in getImagesContinuously(). Frames which don't differ enough from the last
+             * delivered one are not passed to callback. It is useful when camera watches static scene.
+             * @param enable true to enable detection
+             * @param block_threshold mean absolute luma difference (0-255) above which block of MotionDetector is changed
+             * @param min_changed part of blocks (0-1) which have to change to deliver frame
+             * @return CAMERA_SUCCESS
+             * @return CAMERA_BAD_STATE while getImagesContinuously() or capture thread runs
+             * @see getChangeMask()
+             * @see MotionDetector
+             */
+            int setMotionDetection(bool enable, int block_threshold = 10, double min_changed = 0.01);
+
+            /**
+             * Gets mask of blocks changed in the image passed to callback. Call it from callback to process only changed regions.
+             * Block covers MotionDetector::scale * MotionDetector::block_size pixels in each direction.
+             * Mask isn't copied. It is valid until callback returns.
+             * @param columns pointer for number of blocks in row
+             * @param rows pointer for number of rows of blocks
+             * @return mask, row by row, 1 means changed block
+             * @return NULL when detection is disabled
+             */
+            const std::vector<unsigned char>* getChangeMask(int *columns, int *rows);
+
         private:
             enum camera_state {
                 CLOSED,
@@ -257,13 +509,53 @@ namespace V4L2 {
             struct timeval                  tv;
             int                             fd = -1;
             int                             pix_fmt;
+            int                             bytes_per_line = 0;
             unsigned int                    n_buffers;
             std::string                     dev_name;
-            bool stop_flag;
+            std::atomic<bool> stop_flag{false};
+
+            // Capture thread
+            ThreadConfig                    thread_config;
+            std::thread                     capture_thread;
+            std::atomic<int>                capture_thread_result{CAMERA_SUCCESS};
+
+            // Jitter of dequeue loop, Welford's algorithm
+            std::mutex                      jitter_mutex;
+            JitterStatistics                jitter;
+            double                          jitter_m2 = 0;
+            bool                            jitter_started = false;
+            std::chrono::steady_clock::time_point last_dequeue;
+
+            // Controls
+            std::vector<Control>            controls;
+            std::vector<struct v4l2_ext_control> pending_controls;
+            std::atomic<bool>               controls_pending{false};
+            int                             queued_controls_result = CAMERA_SUCCESS;
+            std::mutex                      controls_mutex;
+
+            // Frame rate control
+            unsigned int                    frame_rate = 0;
+            unsigned int                    driver_frame_rate = 0;
+            std::chrono::microseconds       frame_interval = std::chrono::microseconds(0);
+            std::chrono::microseconds       next_frame_due = std::chrono::microseconds(0);
+            std::chrono::microseconds       last_frame_timestamp = std::chrono::microseconds(0);
+
+            // Statistics of the last frame
+            unsigned int                    statistics_flags = STATISTICS_NONE;
+            int                             statistics_subsample = 1;
+            FrameStatistics                 statistics;
+
+            // Change detection
+            bool                            motion_detection = false;
+            MotionDetector                  motion_detector;
+
+            // Camera id of Trace events
+            int                             trace_camera = -1;
 
             struct buffer {
                 void   *start;
                 size_t length;
+                bool   locked;
             } *buffers;
 
             /**
@@ -272,6 +564,66 @@ namespace V4L2 {
             int prepare();
             int unprepare();
 
+            /**
+             * Sets values in one VIDIOC_S_EXT_CTRLS call and updates cache
+             */
+            int applyControls(std::vector<struct v4l2_ext_control> &values);
+
+            /**
+             * Reads current values of controls from driver in one VIDIOC_G_EXT_CTRLS call when possible
+             * @param list controls to update
+             * @param volatile_only read only controls with V4L2_CTRL_FLAG_VOLATILE
+             */
+            void readControlValues(std::vector<Control> &list, bool volatile_only);
+
+            /**
+             * Reads flags, ranges and values of all cached controls again. Called with controls_mutex locked.
+             */
+            void refreshControls();
+
+            /**
+             * Sets controls queued by setControls() with next_frame
+             */
+            void applyPendingControls();
+
+            /**
+             * Sets affinity and scheduling of calling thread from thread_config
+             */
+            int applyThreadConfig();
+
+            /**
+             * Waits until a frame may be dequeued, checking stop_flag
+             * @return false when stopped or on error
+             */
+            bool waitForFrame();
+
+            /**
+             * Adds interval since previous dequeue to jitter
+             */
+            void updateJitter();
+
+            /**
+             * Applies frame_rate to driver and computes frame_interval for skipping.
+             */
+            int applyFrameRate();
+
+            /**
+             * Checks timestamp of dequeued buffer against frame_interval.
+             * @return true when frame should be skipped
+             */
+            bool skipFrame(struct v4l2_buffer const& buffer);
+
+            /**
+             * Runs motion_detector on dequeued buffer
+             * @return true when frame should be delivered
+             */
+            bool detectChange(struct v4l2_buffer const& buffer);
+
+            /**
+             * Computes enabled statistics of dequeued buffer
+             */
+            void updateStatistics(struct v4l2_buffer const& buffer);
+
             /**
              * Function calling v4l2 requests
              * @return 1 on error
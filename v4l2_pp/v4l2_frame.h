@@ -0,0 +1,274 @@
+/**
+@file v4l2_frame.h
+*/
+#ifndef _V4L2_FRAME_H_
+#define _V4L2_FRAME_H_
+
+#include <linux/videodev2.h>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+namespace V4L2 {
+
+    /**
+     * Pixel of V4L2_PIX_FMT_RGB24
+     */
+    struct RGB24Pixel {
+        uint8_t r, g, b;
+    };
+
+    /**
+     * Pixel of V4L2_PIX_FMT_BGR24
+     */
+    struct BGR24Pixel {
+        uint8_t b, g, r;
+    };
+
+    /**
+     * Two horizontal pixels of V4L2_PIX_FMT_YUYV sharing chroma.
+     */
+    struct YUYVPixel {
+        uint8_t y0, u, y1, v;
+    };
+
+    /**
+     * Description of pixel format known at compile time.
+     * Only formats specialized below may be used with FrameView.
+     *
+     * - pixel_type - type of one element of first plane
+     * - bytes_per_pixel - bytes of the first plane per image pixel (2 for YUYV)
+     * - bytes_per_element - size of pixel_type
+     * - pixels_per_element - number of image pixels stored in one pixel_type (2 for YUYV)
+     * - planes - number of planes stored one after another in buffer
+     * - planeStride(), planeHeight(), planeOffset() - layout of each plane computed from stride of the first one
+     * - luma() - luminance of pixel x in row of the first plane
+     */
+    template<uint32_t Format>
+    struct FormatTraits;
+
+    template<>
+    struct FormatTraits<V4L2_PIX_FMT_RGB24> {
+        typedef RGB24Pixel pixel_type;
+        static constexpr unsigned int bytes_per_pixel = 3;
+        static constexpr unsigned int bytes_per_element = 3;
+        static constexpr unsigned int pixels_per_element = 1;
+        static constexpr unsigned int planes = 1;
+        static constexpr int planeStride(unsigned int, int stride) { return stride; }
+        static constexpr int planeHeight(unsigned int, int height) { return height; }
+        static constexpr size_t planeOffset(unsigned int, int, int) { return 0; }
+        static inline uint8_t luma(const uint8_t *row, int x) {
+            return (77 * row[3 * x] + 150 * row[3 * x + 1] + 29 * row[3 * x + 2]) >> 8;
+        }
+    };
+
+    template<>
+    struct FormatTraits<V4L2_PIX_FMT_BGR24> {
+        typedef BGR24Pixel pixel_type;
+        static constexpr unsigned int bytes_per_pixel = 3;
+        static constexpr unsigned int bytes_per_element = 3;
+        static constexpr unsigned int pixels_per_element = 1;
+        static constexpr unsigned int planes = 1;
+        static constexpr int planeStride(unsigned int, int stride) { return stride; }
+        static constexpr int planeHeight(unsigned int, int height) { return height; }
+        static constexpr size_t planeOffset(unsigned int, int, int) { return 0; }
+        static inline uint8_t luma(const uint8_t *row, int x) {
+            return (29 * row[3 * x] + 150 * row[3 * x + 1] + 77 * row[3 * x + 2]) >> 8;
+        }
+    };
+
+    template<>
+    struct FormatTraits<V4L2_PIX_FMT_GREY> {
+        typedef uint8_t pixel_type;
+        static constexpr unsigned int bytes_per_pixel = 1;
+        static constexpr unsigned int bytes_per_element = 1;
+        static constexpr unsigned int pixels_per_element = 1;
+        static constexpr unsigned int planes = 1;
+        static constexpr int planeStride(unsigned int, int stride) { return stride; }
+        static constexpr int planeHeight(unsigned int, int height) { return height; }
+        static constexpr size_t planeOffset(unsigned int, int, int) { return 0; }
+        static inline uint8_t luma(const uint8_t *row, int x) { return row[x]; }
+    };
+
+    template<>
+    struct FormatTraits<V4L2_PIX_FMT_YUYV> {
+        typedef YUYVPixel pixel_type;
+        static constexpr unsigned int bytes_per_pixel = 2;
+        static constexpr unsigned int bytes_per_element = 4;
+        static constexpr unsigned int pixels_per_element = 2;
+        static constexpr unsigned int planes = 1;
+        static constexpr int planeStride(unsigned int, int stride) { return stride; }
+        static constexpr int planeHeight(unsigned int, int height) { return height; }
+        static constexpr size_t planeOffset(unsigned int, int, int) { return 0; }
+        static inline uint8_t luma(const uint8_t *row, int x) { return row[2 * x]; }
+    };
+
+    /**
+     * Y plane followed by interleaved UV plane of half height.
+     */
+    template<>
+    struct FormatTraits<V4L2_PIX_FMT_NV12> {
+        typedef uint8_t pixel_type;
+        static constexpr unsigned int bytes_per_pixel = 1;
+        static constexpr unsigned int bytes_per_element = 1;
+        static constexpr unsigned int pixels_per_element = 1;
+        static constexpr unsigned int planes = 2;
+        static constexpr int planeStride(unsigned int, int stride) { return stride; }
+        static constexpr int planeHeight(unsigned int plane, int height) { return plane == 0 ? height : height / 2; }
+        static constexpr size_t planeOffset(unsigned int plane, int stride, int height) {
+            return plane == 0 ? 0 : (size_t)stride * height;
+        }
+        static inline uint8_t luma(const uint8_t *row, int x) { return row[x]; }
+    };
+
+    /**
+     * Y plane followed by U and V planes of half width and half height.
+     */
+    template<>
+    struct FormatTraits<V4L2_PIX_FMT_YUV420> {
+        typedef uint8_t pixel_type;
+        static constexpr unsigned int bytes_per_pixel = 1;
+        static constexpr unsigned int bytes_per_element = 1;
+        static constexpr unsigned int pixels_per_element = 1;
+        static constexpr unsigned int planes = 3;
+        static constexpr int planeStride(unsigned int plane, int stride) { return plane == 0 ? stride : stride / 2; }
+        static constexpr int planeHeight(unsigned int plane, int height) { return plane == 0 ? height : height / 2; }
+        static constexpr size_t planeOffset(unsigned int plane, int stride, int height) {
+            return plane == 0 ? 0
+                : plane == 1 ? (size_t)stride * height
+                : (size_t)stride * height + (size_t)(stride / 2) * (height / 2);
+        }
+        static inline uint8_t luma(const uint8_t *row, int x) { return row[x]; }
+    };
+
+    /**
+     * Non owning view of a frame in format known at compile time.
+     * It doesn't copy data, so it is valid as long as the buffer is (i.e. until callback returns).
+     * Kernels written against row() are specialized for the format, so compiler can vectorize them:
+     * \code    {.cpp}
+     * V4L2::FrameView<V4L2_PIX_FMT_RGB24> frame = camera.view<V4L2_PIX_FMT_RGB24>(bytes);
+     * for(int y = 0; y < frame.height(); y++){
+     *     V4L2::RGB24Pixel *row = frame.row(y);
+     *     for(int x = 0; x < frame.elements(); x++)
+     *         row[x].r = 0;
+     * }
+     * \endcode
+     */
+    template<uint32_t Format>
+    class FrameView
+    {
+        public:
+            typedef FormatTraits<Format> traits;
+            typedef typename traits::pixel_type pixel_type;
+
+            static_assert(sizeof(pixel_type) == traits::bytes_per_element, "pixel_type has to be packed");
+
+            /**
+             * Iterator over all pixels (elements) of the first plane, row by row, skipping row padding.
+             * For hot loops prefer row(), it doesn't check end of row on every step.
+             */
+            class iterator
+            {
+                public:
+                    typedef std::forward_iterator_tag iterator_category;
+                    typedef typename FrameView::pixel_type value_type;
+                    typedef std::ptrdiff_t difference_type;
+                    typedef value_type* pointer;
+                    typedef value_type& reference;
+
+                    iterator(uint8_t *row, int x, int elements, int stride)
+                        : row_(row), x_(x), elements_(elements), stride_(stride) {}
+
+                    pixel_type& operator*() const { return reinterpret_cast<pixel_type*>(row_)[x_]; }
+                    pixel_type* operator->() const { return &**this; }
+
+                    iterator& operator++() {
+                        if(++x_ == elements_){
+                            x_ = 0;
+                            row_ += stride_;
+                        }
+                        return *this;
+                    }
+                    iterator operator++(int) {
+                        iterator tmp = *this;
+                        ++*this;
+                        return tmp;
+                    }
+
+                    bool operator==(iterator const& other) const { return row_ == other.row_ && x_ == other.x_; }
+                    bool operator!=(iterator const& other) const { return !(*this == other); }
+
+                private:
+                    uint8_t *row_;
+                    int x_;
+                    int elements_;
+                    int stride_;
+            };
+
+            /**
+             * @param data pointer to the first byte of the frame
+             * @param width width in pixels
+             * @param height height in pixels
+             * @param stride bytes per line of the first plane. 0 means no padding
+             */
+            FrameView(uint8_t *data, int width, int height, int stride = 0)
+                : data_(data), width_(width), height_(height),
+                stride_(stride != 0 ? stride : width / (int)traits::pixels_per_element * (int)traits::bytes_per_element) {}
+
+            uint8_t* data() const { return data_; }
+            int width() const { return width_; }
+            int height() const { return height_; }
+            /**
+             * Bytes per line of the first plane
+             */
+            int stride() const { return stride_; }
+            /**
+             * Number of pixel_type elements in a row of the first plane
+             */
+            int elements() const { return width_ / (int)traits::pixels_per_element; }
+            /**
+             * @return false when view doesn't point at any frame
+             */
+            bool valid() const { return data_ != NULL; }
+
+            /**
+             * Row of the first plane
+             */
+            pixel_type* row(int y) const { return reinterpret_cast<pixel_type*>(data_ + (size_t)y * stride_); }
+
+            /**
+             * Element of the first plane. For YUYV x is index of pixel pair.
+             */
+            pixel_type& at(int x, int y) const { return row(y)[x]; }
+
+            /**
+             * Luminance of pixel x, y computed the way suitable for the format
+             */
+            uint8_t luma(int x, int y) const { return traits::luma(data_ + (size_t)y * stride_, x); }
+
+            uint8_t* plane(unsigned int p) const { return data_ + traits::planeOffset(p, stride_, height_); }
+            int planeStride(unsigned int p) const { return traits::planeStride(p, stride_); }
+            int planeHeight(unsigned int p) const { return traits::planeHeight(p, height_); }
+            /**
+             * Row y of plane p as bytes
+             */
+            uint8_t* planeRow(unsigned int p, int y) const { return plane(p) + (size_t)y * planeStride(p); }
+
+            /**
+             * Size of all planes in bytes
+             */
+            size_t size() const { return traits::planeOffset(traits::planes - 1, stride_, height_)
+                + (size_t)planeStride(traits::planes - 1) * planeHeight(traits::planes - 1); }
+
+            iterator begin() const { return iterator(data_, 0, elements(), stride_); }
+            iterator end() const { return iterator(data_ + (size_t)height_ * stride_, 0, elements(), stride_); }
+
+        private:
+            uint8_t *data_;
+            int width_;
+            int height_;
+            int stride_;
+    };
+}
+
+#endif // _V4L2_FRAME_H_
@@ -0,0 +1,153 @@
+#include "v4l2_motion.h"
+#include "v4l2_frame.h"
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace V4L2;
+
+constexpr int MotionDetector::scale;
+constexpr int MotionDetector::block_size;
+
+namespace {
+
+    /**
+     * Samples luma of every scale-th pixel of every scale-th row into out
+     * @param out downsampled image with given stride, its padding stays untouched
+     */
+    template<uint32_t Format>
+    void sample(FrameView<Format> const& frame, uint8_t *out, int out_stride)
+    {
+        const int scale = MotionDetector::scale;
+        int out_width = frame.width() / scale;
+        int out_height = frame.height() / scale;
+        for (int y = 0; y < out_height; y++) {
+            const uint8_t *row = frame.planeRow(0, y * scale);
+            uint8_t *out_row = out + (size_t)y * out_stride;
+            for (int x = 0; x < out_width; x++)
+                out_row[x] = FormatTraits<Format>::luma(row, x * scale);
+        }
+    }
+
+    /**
+     * Sum of absolute differences of block_size x block_size block
+     */
+    uint32_t blockSad(const uint8_t *a, const uint8_t *b, int stride)
+    {
+        uint32_t sad = 0;
+        for (int y = 0; y < MotionDetector::block_size; y++, a += stride, b += stride)
+            for (int x = 0; x < MotionDetector::block_size; x++)
+                sad += a[x] > b[x] ? a[x] - b[x] : b[x] - a[x];
+        return sad;
+    }
+}
+
+MotionDetector::MotionDetector(int block_threshold, double min_changed)
+{
+    this->block_threshold = block_threshold;
+    this->min_changed = min_changed;
+}
+
+void MotionDetector::reset()
+{
+    has_reference = false;
+}
+
+bool MotionDetector::downsample(const uint8_t *data, int pix_fmt, int width, int height, int stride)
+{
+    int columns = (width / scale + block_size - 1) / block_size;
+    int rows = (height / scale + block_size - 1) / block_size;
+    if (columns != columns_ || rows != rows_) {
+        columns_ = columns;
+        rows_ = rows;
+        // Padding of the last blocks is zero in both images, so it never differs
+        reference.assign((size_t)columns * rows * block_size * block_size, 0);
+        current.assign(reference.size(), 0);
+        mask_.assign((size_t)columns * rows, 1);
+        has_reference = false;
+    }
+
+    uint8_t *bytes = const_cast<uint8_t*>(data);
+    int out_stride = columns * block_size;
+    switch (pix_fmt) {
+        case V4L2_PIX_FMT_RGB24:
+            sample(FrameView<V4L2_PIX_FMT_RGB24>(bytes, width, height, stride), current.data(), out_stride);
+            return true;
+        case V4L2_PIX_FMT_BGR24:
+            sample(FrameView<V4L2_PIX_FMT_BGR24>(bytes, width, height, stride), current.data(), out_stride);
+            return true;
+        case V4L2_PIX_FMT_GREY:
+            sample(FrameView<V4L2_PIX_FMT_GREY>(bytes, width, height, stride), current.data(), out_stride);
+            return true;
+        case V4L2_PIX_FMT_YUYV:
+            sample(FrameView<V4L2_PIX_FMT_YUYV>(bytes, width, height, stride), current.data(), out_stride);
+            return true;
+        case V4L2_PIX_FMT_NV12:
+            sample(FrameView<V4L2_PIX_FMT_NV12>(bytes, width, height, stride), current.data(), out_stride);
+            return true;
+        case V4L2_PIX_FMT_YUV420:
+            sample(FrameView<V4L2_PIX_FMT_YUV420>(bytes, width, height, stride), current.data(), out_stride);
+            return true;
+        default:
+            return false;
+    }
+}
+
+int MotionDetector::compare()
+{
+    const uint32_t threshold = (uint32_t)block_threshold * block_size * block_size;
+    const int stride = columns_ * block_size;
+    int changed = 0;
+
+    for (int by = 0; by < rows_; by++) {
+        const uint8_t *cur = current.data() + (size_t)by * block_size * stride;
+        const uint8_t *ref = reference.data() + (size_t)by * block_size * stride;
+        uint8_t *mask_row = mask_.data() + (size_t)by * columns_;
+        int bx = 0;
+#if defined(__SSE2__)
+        // Each 64 bit half of _mm_sad_epu8 result is SAD of 8 bytes, so two neighbouring blocks are done at once
+        for (; bx + 2 <= columns_; bx += 2) {
+            __m128i acc = _mm_setzero_si128();
+            for (int y = 0; y < block_size; y++) {
+                size_t offset = (size_t)y * stride + bx * block_size;
+                acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(cur + offset)),
+                            _mm_loadu_si128((const __m128i*)(ref + offset))));
+            }
+            uint32_t sad0 = _mm_cvtsi128_si32(acc);
+            uint32_t sad1 = _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+            mask_row[bx] = sad0 > threshold;
+            mask_row[bx + 1] = sad1 > threshold;
+            changed += mask_row[bx] + mask_row[bx + 1];
+        }
+#endif
+        for (; bx < columns_; bx++) {
+            mask_row[bx] = blockSad(cur + bx * block_size, ref + bx * block_size, stride) > threshold;
+            changed += mask_row[bx];
+        }
+    }
+    return changed;
+}
+
+bool MotionDetector::process(const uint8_t *data, int pix_fmt, int width, int height, int stride)
+{
+    if (!downsample(data, pix_fmt, width, height, stride)) {
+        mask_.assign(mask_.size(), 1);
+        return true;
+    }
+
+    if (!has_reference) {
+        mask_.assign(mask_.size(), 1);
+        reference.swap(current);
+        has_reference = true;
+        return true;
+    }
+
+    int changed = compare();
+    if (changed == 0 || changed < min_changed * columns_ * rows_)
+        return false;
+
+    reference.swap(current);
+    return true;
+}
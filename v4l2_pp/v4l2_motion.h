@@ -0,0 +1,81 @@
+/**
+@file v4l2_motion.h
+*/
+#ifndef _V4L2_MOTION_H_
+#define _V4L2_MOTION_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace V4L2 {
+
+    /**
+     * Detects changes between frames.
+     * Each frame is downsampled (every MotionDetector::scale pixel of every scale row) and compared block by block
+     * with downsampled reference. Reference is replaced by the frame, which was reported as changed,
+     * so slow changes are accumulated until they are big enough.
+     */
+    class MotionDetector
+    {
+        public:
+            /**
+             * Downsampling factor in both directions
+             */
+            static constexpr int scale = 4;
+
+            /**
+             * Size of a block in downsampled image. In frame it is scale * block_size pixels.
+             */
+            static constexpr int block_size = 8;
+
+            /**
+             * @param block_threshold mean absolute luma difference of pixels in block (0-255), above which block is changed
+             * @param min_changed part of blocks (0-1) which have to change to report frame as changed.
+             * At least one changed block is always needed.
+             */
+            MotionDetector(int block_threshold = 10, double min_changed = 0.01);
+
+            /**
+             * Compares frame with reference and updates change mask
+             * @param data frame data
+             * @param pix_fmt V4L2 pixel format of data. Supported formats are these with FormatTraits.
+             * @param width width in pixels
+             * @param height height in pixels
+             * @param stride bytes per line of the first plane. 0 means no padding
+             * @return true when frame changed enough, it is the first one or its format isn't supported
+             */
+            bool process(const uint8_t *data, int pix_fmt, int width, int height, int stride);
+
+            /**
+             * Forgets reference, so next frame is reported as changed
+             */
+            void reset();
+
+            /**
+             * Mask of changed blocks of last processed frame, row by row. 1 means block changed.
+             * Block at column x, row y covers frame pixels from (x, y) * scale * block_size.
+             */
+            std::vector<uint8_t> const& mask() const { return mask_; }
+            int columns() const { return columns_; }
+            int rows() const { return rows_; }
+
+        private:
+            int block_threshold;
+            double min_changed;
+            int columns_ = 0;
+            int rows_ = 0;
+            bool has_reference = false;
+            std::vector<uint8_t> reference;
+            std::vector<uint8_t> current;
+            std::vector<uint8_t> mask_;
+
+            /**
+             * Writes downsampled luma of frame into current
+             * @return false when format isn't supported
+             */
+            bool downsample(const uint8_t *data, int pix_fmt, int width, int height, int stride);
+            int compare();
+    };
+}
+
+#endif // _V4L2_MOTION_H_
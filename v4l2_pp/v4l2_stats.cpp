@@ -0,0 +1,235 @@
+#include "v4l2_camera.h"
+#include "v4l2_stats.h"
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace V4L2;
+
+namespace {
+
+    /**
+     * Sum of n bytes
+     */
+    uint64_t sumRow(const uint8_t *p, int n)
+    {
+        uint64_t sum = 0;
+        int i = 0;
+#if defined(__SSE2__)
+        __m128i acc = _mm_setzero_si128();
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= n; i += 16)
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(p + i)), zero));
+        sum = (uint64_t)_mm_cvtsi128_si32(acc) + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+        for (; i < n; i++)
+            sum += p[i];
+        return sum;
+    }
+
+    /**
+     * Sum of |p[i+1] - p[i]| for n bytes
+     */
+    uint64_t gradientRow(const uint8_t *p, int n)
+    {
+        uint64_t sum = 0;
+        int i = 0;
+#if defined(__SSE2__)
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 17 <= n; i += 16)
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(p + i)),
+                        _mm_loadu_si128((const __m128i*)(p + i + 1))));
+        sum = (uint64_t)_mm_cvtsi128_si32(acc) + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+        for (; i + 1 < n; i++)
+            sum += p[i] > p[i + 1] ? p[i] - p[i + 1] : p[i + 1] - p[i];
+        return sum;
+    }
+
+    /**
+     * Histogram using four partial tables, so neighbouring equal pixels don't wait for each other
+     */
+    void histogramRow(const uint8_t *p, int n, uint32_t (*partial)[256])
+    {
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            partial[0][p[i]]++;
+            partial[1][p[i + 1]]++;
+            partial[2][p[i + 2]]++;
+            partial[3][p[i + 3]]++;
+        }
+        for (; i < n; i++)
+            partial[0][p[i]]++;
+    }
+
+    /**
+     * Returns row of luma. Formats with luma plane don't need any copy.
+     */
+    template<uint32_t Format>
+    struct LumaRow {
+        static const uint8_t* get(FrameView<Format> const& frame, int y, uint8_t *tmp) {
+            const uint8_t *row = frame.planeRow(0, y);
+            for (int x = 0; x < frame.width(); x++)
+                tmp[x] = FormatTraits<Format>::luma(row, x);
+            return tmp;
+        }
+    };
+
+    template<>
+    const uint8_t* LumaRow<V4L2_PIX_FMT_YUYV>::get(FrameView<V4L2_PIX_FMT_YUYV> const& frame, int y, uint8_t *tmp)
+    {
+        const uint8_t *row = frame.planeRow(0, y);
+        int x = 0;
+#if defined(__SSE2__)
+        const __m128i mask = _mm_set1_epi16(0x00ff);
+        for (; x + 16 <= frame.width(); x += 16) {
+            __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(row + 2 * x)), mask);
+            __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(row + 2 * x + 16)), mask);
+            _mm_storeu_si128((__m128i*)(tmp + x), _mm_packus_epi16(a, b));
+        }
+#endif
+        for (; x < frame.width(); x++)
+            tmp[x] = row[2 * x];
+        return tmp;
+    }
+
+    /**
+     * Luma of packed three byte pixels, weights C0, C1, C2 of bytes in memory order.
+     * Same result as FormatTraits::luma()
+     */
+    template<int C0, int C1, int C2>
+    void packedLumaRow(const uint8_t *row, int width, uint8_t *tmp)
+    {
+        int x = 0;
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i c0 = _mm_set1_epi16(C0), c1 = _mm_set1_epi16(C1), c2 = _mm_set1_epi16(C2);
+        for (; x + 16 <= width; x += 16) {
+            // Deinterleave 16 pixels into three planes of 16 bytes by repeated unpacking
+            __m128i t0 = _mm_loadu_si128((const __m128i*)(row + 3 * x));
+            __m128i t1 = _mm_loadu_si128((const __m128i*)(row + 3 * x + 16));
+            __m128i t2 = _mm_loadu_si128((const __m128i*)(row + 3 * x + 32));
+            for (int i = 0; i < 4; i++) {
+                __m128i u0 = _mm_unpacklo_epi8(t0, _mm_unpackhi_epi64(t1, t1));
+                __m128i u1 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t0, t0), t2);
+                __m128i u2 = _mm_unpacklo_epi8(t1, _mm_unpackhi_epi64(t2, t2));
+                t0 = u0;
+                t1 = u1;
+                t2 = u2;
+            }
+            __m128i lo = _mm_add_epi16(_mm_add_epi16(
+                        _mm_mullo_epi16(_mm_unpacklo_epi8(t0, zero), c0),
+                        _mm_mullo_epi16(_mm_unpacklo_epi8(t1, zero), c1)),
+                        _mm_mullo_epi16(_mm_unpacklo_epi8(t2, zero), c2));
+            __m128i hi = _mm_add_epi16(_mm_add_epi16(
+                        _mm_mullo_epi16(_mm_unpackhi_epi8(t0, zero), c0),
+                        _mm_mullo_epi16(_mm_unpackhi_epi8(t1, zero), c1)),
+                        _mm_mullo_epi16(_mm_unpackhi_epi8(t2, zero), c2));
+            // Weights sum to 256, so the sum fits unsigned 16 bits
+            _mm_storeu_si128((__m128i*)(tmp + x), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+        }
+#endif
+        for (; x < width; x++)
+            tmp[x] = (C0 * row[3 * x] + C1 * row[3 * x + 1] + C2 * row[3 * x + 2]) >> 8;
+    }
+
+    template<>
+    const uint8_t* LumaRow<V4L2_PIX_FMT_RGB24>::get(FrameView<V4L2_PIX_FMT_RGB24> const& frame, int y, uint8_t *tmp)
+    {
+        packedLumaRow<77, 150, 29>(frame.planeRow(0, y), frame.width(), tmp);
+        return tmp;
+    }
+
+    template<>
+    const uint8_t* LumaRow<V4L2_PIX_FMT_BGR24>::get(FrameView<V4L2_PIX_FMT_BGR24> const& frame, int y, uint8_t *tmp)
+    {
+        packedLumaRow<29, 150, 77>(frame.planeRow(0, y), frame.width(), tmp);
+        return tmp;
+    }
+
+    template<>
+    const uint8_t* LumaRow<V4L2_PIX_FMT_GREY>::get(FrameView<V4L2_PIX_FMT_GREY> const& frame, int y, uint8_t *)
+    {
+        return frame.planeRow(0, y);
+    }
+
+    template<>
+    const uint8_t* LumaRow<V4L2_PIX_FMT_NV12>::get(FrameView<V4L2_PIX_FMT_NV12> const& frame, int y, uint8_t *)
+    {
+        return frame.planeRow(0, y);
+    }
+
+    template<>
+    const uint8_t* LumaRow<V4L2_PIX_FMT_YUV420>::get(FrameView<V4L2_PIX_FMT_YUV420> const& frame, int y, uint8_t *)
+    {
+        return frame.planeRow(0, y);
+    }
+
+    template<uint32_t Format>
+    void compute(FrameView<Format> const& frame, unsigned int flags, int subsample, FrameStatistics *stats)
+    {
+        std::vector<uint8_t> tmp(frame.width());
+        uint32_t partial[4][256];
+        if (flags & STATISTICS_HISTOGRAM)
+            memset(partial, 0, sizeof(partial));
+
+        uint64_t sum = 0, gradient = 0;
+        uint32_t rows = 0;
+        for (int y = 0; y < frame.height(); y += subsample) {
+            const uint8_t *luma = LumaRow<Format>::get(frame, y, tmp.data());
+            if (flags & STATISTICS_HISTOGRAM)
+                histogramRow(luma, frame.width(), partial);
+            if (flags & STATISTICS_MEAN_LUMA)
+                sum += sumRow(luma, frame.width());
+            if (flags & STATISTICS_SHARPNESS)
+                gradient += gradientRow(luma, frame.width());
+            rows++;
+        }
+
+        stats->flags = flags;
+        stats->samples = rows * frame.width();
+        if (flags & STATISTICS_HISTOGRAM)
+            for (int i = 0; i < 256; i++)
+                stats->histogram[i] = partial[0][i] + partial[1][i] + partial[2][i] + partial[3][i];
+        if (flags & STATISTICS_MEAN_LUMA)
+            stats->mean_luma = stats->samples != 0 ? (double)sum / stats->samples : 0;
+        if (flags & STATISTICS_SHARPNESS)
+            stats->sharpness = frame.width() > 1 && rows != 0 ? (double)gradient / (rows * (frame.width() - 1)) : 0;
+    }
+}
+
+int V4L2::computeStatistics(const uint8_t *data, int pix_fmt, int width, int height, int stride,
+        unsigned int flags, int subsample, FrameStatistics *stats)
+{
+    uint8_t *bytes = const_cast<uint8_t*>(data);
+    if (subsample < 1)
+        subsample = 1;
+
+    switch (pix_fmt) {
+        case V4L2_PIX_FMT_RGB24:
+            compute(FrameView<V4L2_PIX_FMT_RGB24>(bytes, width, height, stride), flags, subsample, stats);
+            break;
+        case V4L2_PIX_FMT_BGR24:
+            compute(FrameView<V4L2_PIX_FMT_BGR24>(bytes, width, height, stride), flags, subsample, stats);
+            break;
+        case V4L2_PIX_FMT_GREY:
+            compute(FrameView<V4L2_PIX_FMT_GREY>(bytes, width, height, stride), flags, subsample, stats);
+            break;
+        case V4L2_PIX_FMT_YUYV:
+            compute(FrameView<V4L2_PIX_FMT_YUYV>(bytes, width, height, stride), flags, subsample, stats);
+            break;
+        case V4L2_PIX_FMT_NV12:
+            compute(FrameView<V4L2_PIX_FMT_NV12>(bytes, width, height, stride), flags, subsample, stats);
+            break;
+        case V4L2_PIX_FMT_YUV420:
+            compute(FrameView<V4L2_PIX_FMT_YUV420>(bytes, width, height, stride), flags, subsample, stats);
+            break;
+        default:
+            stats->flags = STATISTICS_NONE;
+            return CAMERA_WRONG_PIXELFORMAT;
+    }
+    return CAMERA_SUCCESS;
+}
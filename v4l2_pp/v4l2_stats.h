@@ -0,0 +1,52 @@
+/**
+@file v4l2_stats.h
+*/
+#ifndef _V4L2_STATS_H_
+#define _V4L2_STATS_H_
+
+#include <cstdint>
+
+namespace V4L2 {
+
+    /**
+     * Statistics which may be computed for every frame. Values may be joined with |.
+     */
+    enum {
+        STATISTICS_NONE = 0,///<Don't compute statistics
+        STATISTICS_HISTOGRAM = 1,///<Luma histogram
+        STATISTICS_MEAN_LUMA = 2,///<Mean luma
+        STATISTICS_SHARPNESS = 4,///<Mean absolute horizontal luma gradient
+        STATISTICS_ALL = 7///<All of above
+    };
+
+    /**
+     * Statistics of one frame, computed on luma of the native format buffer.
+     */
+    struct FrameStatistics {
+        unsigned int flags = STATISTICS_NONE;///<Which statistics are valid
+        uint32_t sequence = 0;///<Sequence number of the frame given by driver
+        uint32_t samples = 0;///<Number of sampled pixels
+        uint32_t histogram[256];///<Number of sampled pixels with given luma
+        double mean_luma = 0;///<Mean luma in range 0-255
+        double sharpness = 0;///<Mean absolute difference of horizontally neighbouring pixels. Higher is sharper
+    };
+
+    /**
+     * Computes statistics of a frame in its native format.
+     * Supported formats are these with FormatTraits (RGB24, BGR24, GREY, YUYV, NV12, YUV420).
+     * @param data frame data
+     * @param pix_fmt V4L2 pixel format of data
+     * @param width width in pixels
+     * @param height height in pixels
+     * @param stride bytes per line of the first plane. 0 means no padding
+     * @param flags STATISTICS_* values joined with |
+     * @param subsample only every subsample-th row is used
+     * @param stats output
+     * @return CAMERA_SUCCESS
+     * @return CAMERA_WRONG_PIXELFORMAT when format isn't supported
+     */
+    int computeStatistics(const uint8_t *data, int pix_fmt, int width, int height, int stride,
+            unsigned int flags, int subsample, FrameStatistics *stats);
+}
+
+#endif // _V4L2_STATS_H_
@@ -0,0 +1,177 @@
+#include "v4l2_camera.h"
+#include "v4l2_trace.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+using namespace V4L2;
+
+std::atomic<bool> Trace::enabled_flag(false);
+
+namespace {
+
+    struct Event {
+        const char *name;
+        uint64_t begin;
+        uint64_t end;
+        int camera;
+        uint32_t frame;
+    };
+
+    /**
+     * Ring buffer written only by its thread. head is published with release, so dump() sees complete events.
+     */
+    struct ThreadBuffer {
+        std::vector<Event> events;
+        std::atomic<uint64_t> head;
+        long tid;
+        std::string name;
+        unsigned int generation;
+    };
+
+    std::mutex registry_mutex;
+    std::vector<std::shared_ptr<ThreadBuffer> > buffers;
+    std::vector<std::string> cameras;
+    size_t buffer_size = 65536;
+    // Changed by enable(), so threads replace buffers from previous recording
+    std::atomic<unsigned int> generation(0);
+
+    thread_local std::shared_ptr<ThreadBuffer> thread_buffer;
+    thread_local std::string thread_name;
+
+    ThreadBuffer* threadBuffer()
+    {
+        unsigned int current = generation.load(std::memory_order_acquire);
+        if(thread_buffer && thread_buffer->generation == current)
+            return thread_buffer.get();
+
+        std::shared_ptr<ThreadBuffer> buffer = std::make_shared<ThreadBuffer>();
+        buffer->head.store(0, std::memory_order_relaxed);
+        buffer->tid = syscall(SYS_gettid);
+        buffer->name = thread_name;
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        buffer->generation = generation.load(std::memory_order_relaxed);
+        buffer->events.resize(buffer_size);
+        buffers.push_back(buffer);
+        thread_buffer = buffer;
+        return buffer.get();
+    }
+
+    /**
+     * Writes string as JSON string, escaping special characters
+     */
+    void writeString(FILE *file, std::string const& text)
+    {
+        fputc('"', file);
+        for(char c : text){
+            if(c == '"' || c == '\\')
+                fputc('\\', file);
+            if((unsigned char)c < 0x20)
+                fprintf(file, "\\u%04x", c);
+            else
+                fputc(c, file);
+        }
+        fputc('"', file);
+    }
+}
+
+void Trace::enable(size_t events_per_thread)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    buffers.clear();
+    buffer_size = events_per_thread < 1 ? 1 : events_per_thread;
+    generation.fetch_add(1, std::memory_order_release);
+    enabled_flag.store(true, std::memory_order_relaxed);
+}
+
+void Trace::disable()
+{
+    enabled_flag.store(false, std::memory_order_relaxed);
+}
+
+void Trace::setThreadName(std::string const& name)
+{
+    thread_name = name;
+    if(thread_buffer){
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        thread_buffer->name = name;
+    }
+}
+
+int Trace::registerCamera(std::string const& name)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    // Reopened device keeps its id, so registry doesn't grow with every open()
+    for(size_t i = 0; i < cameras.size(); i++){
+        if(cameras[i] == name)
+            return i;
+    }
+    cameras.push_back(name);
+    return cameras.size() - 1;
+}
+
+uint64_t Trace::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const char *name, uint64_t begin, uint64_t end, int camera, uint32_t frame)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    Event &event = buffer->events[head % buffer->events.size()];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    event.camera = camera;
+    event.frame = frame;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+int Trace::dump(std::string const& path)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if(file == NULL)
+        return CAMERA_ERROR;
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    int pid = getpid();
+    bool first = true;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for(std::shared_ptr<ThreadBuffer> const& buffer : buffers){
+        if(!buffer->name.empty()){
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%ld,\"args\":{\"name\":",
+                    first ? "" : ",\n", pid, buffer->tid);
+            writeString(file, buffer->name);
+            fprintf(file, "}}");
+            first = false;
+        }
+
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t size = buffer->events.size();
+        for(uint64_t i = head > size ? head - size : 0; i < head; i++){
+            Event const& event = buffer->events[i % size];
+            fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+            writeString(file, event.name);
+            fprintf(file, ",\"cat\":\"v4l2\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld",
+                    event.begin / 1000.0, (event.end - event.begin) / 1000.0, pid, buffer->tid);
+            if(event.camera >= 0 && (size_t)event.camera < cameras.size()){
+                fprintf(file, ",\"args\":{\"camera\":");
+                writeString(file, cameras[event.camera]);
+                fprintf(file, ",\"frame\":%u}", event.frame);
+            }
+            fprintf(file, "}");
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    if(fclose(file) != 0)
+        return CAMERA_ERROR;
+    return CAMERA_SUCCESS;
+}
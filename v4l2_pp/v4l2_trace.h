@@ -0,0 +1,125 @@
+/**
+@file v4l2_trace.h
+*/
+#ifndef _V4L2_TRACE_H_
+#define _V4L2_TRACE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace V4L2 {
+
+    /**
+     * Per frame timeline tracing. When enabled, Camera records spans of waiting for frame, dequeuing, processing, callback and queuing
+     * of every frame. Application threads (i.e. processing pipeline) may record own spans using Trace::Span.
+     * Events are kept in per thread ring buffers, so recording doesn't take any lock. When tracing is disabled,
+     * span costs one atomic load.
+     * Saved file is in Chrome trace format and may be opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+     * \code    {.cpp}
+     * V4L2::Trace::enable();
+     * camera.getImagesContinuously([](unsigned char *bytes){
+     *     V4L2::Trace::Span span("detect");
+     *     ...
+     * });
+     * V4L2::Trace::disable();
+     * V4L2::Trace::dump("trace.json");
+     * \endcode
+     */
+    namespace Trace {
+
+        /**
+         * State used by enabled(). Don't use it directly.
+         */
+        extern std::atomic<bool> enabled_flag;
+
+        /**
+         * Starts recording. Events recorded before are dropped.
+         * @param events_per_thread size of ring buffer of each thread. When it is full, the oldest events are overwritten
+         */
+        void enable(size_t events_per_thread = 65536);
+
+        /**
+         * Stops recording. Recorded events are kept for dump().
+         */
+        void disable();
+
+        /**
+         * @return true when recording
+         */
+        inline bool enabled()
+        {
+            return enabled_flag.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Names calling thread on the timeline
+         */
+        void setThreadName(std::string const& name);
+
+        /**
+         * Registers camera, so its events are labeled with name. Cameras with the same name share id.
+         * @return camera id to pass to Span
+         */
+        int registerCamera(std::string const& name);
+
+        /**
+         * Monotonic time in nanoseconds, used for events
+         */
+        uint64_t now();
+
+        /**
+         * Records span of calling thread
+         * @param name name of span. It has to be string literal or live until dump()
+         * @param begin start time from now()
+         * @param end end time from now()
+         * @param camera camera id from registerCamera() or -1
+         * @param frame frame sequence number
+         */
+        void record(const char *name, uint64_t begin, uint64_t end, int camera = -1, uint32_t frame = 0);
+
+        /**
+         * Writes recorded events of all threads as Chrome trace JSON.
+         * It should be called after disable(), otherwise events recorded during dump may be damaged.
+         * @param path path of output file
+         * @return CAMERA_SUCCESS
+         * @return CAMERA_ERROR when file can't be written
+         */
+        int dump(std::string const& path);
+
+        /**
+         * Records time between construction and destruction.
+         */
+        class Span
+        {
+            public:
+                /**
+                 * @param name name of span. It has to be string literal or live until dump()
+                 * @param camera camera id from registerCamera() or -1
+                 * @param frame frame sequence number
+                 */
+                Span(const char *name, int camera = -1, uint32_t frame = 0)
+                    : name(name), camera(camera), frame(frame), begin(enabled() ? now() : 0) {}
+
+                ~Span()
+                {
+                    if(begin != 0 && enabled())
+                        record(name, begin, now(), camera, frame);
+                }
+
+                /**
+                 * Sets frame number known after span was started (i.e. after dequeuing)
+                 */
+                void setFrame(uint32_t frame) { this->frame = frame; }
+
+            private:
+                const char *name;
+                int camera;
+                uint32_t frame;
+                uint64_t begin;
+        };
+    }
+}
+
+#endif // _V4L2_TRACE_H_